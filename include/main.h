@@ -3,7 +3,9 @@
 
 #include <sensitive.h>
 
-#define SUMP_MONITOR_VERSION  __DATE__ " " __TIME__
+// Defined once, in main.cpp, from the SUMP_MONITOR_VERSION build flag (platformio.ini).
+// It is what the service announces for firmware updates.
+extern const char SumpMonitorVersion[];
 #define DEVICE_ID       "sump"
 
 // Events in order of severity
@@ -15,12 +17,33 @@
 #define IOT_EVENT_BACKUP      5
 #define IOT_EVENT_FLOOD       6
 
+// Stages of loop() watched for stalls
+#define LOOP_STAGE_IDLE         0
+#define LOOP_STAGE_SETUP        1
+#define LOOP_STAGE_RESET_NOTIFY 2
+#define LOOP_STAGE_CONFIG       3
+#define LOOP_STAGE_BUTTON       4
+#define LOOP_STAGE_FLOATS       5
+#define LOOP_STAGE_ALARM        6
+#define LOOP_STAGE_MQTT         7
+#define LOOP_STAGE_OTA          8
+#define LOOP_STAGE_POWER        9
+#define LOOP_STAGE_DOZE         10
+#define LOOP_STAGE_WIFI         11
+
 #define IOT_API_BASE_URL "http://" IOT_SERVICE_FQDN "/cgi-bin/luci/iot-helper/api"
 
+#if defined(MQTT_BROKER_FQDN) && !defined(MQTT_BROKER_PORT)
+#define MQTT_BROKER_PORT 1883
+#endif
+
 struct ApplicationConfig {
-  unsigned long MainLoopMs = 1 * 1000; // every second
+  unsigned long MainLoopMs = 5 * 1000; // every 5 seconds, while the sump is quiet
+  unsigned long ActiveLoopMs = 50; // fast sampling while floats are changing or the pump runs
+  unsigned long ActiveHoldMs = 30 * 1000; // 30 seconds of fast sampling after the last activity
+  unsigned long DebounceMs = 2 * 1000; // How long a float's reading must hold to confirm its state.
   unsigned long UpdateConfigMs = 5 * 60 * 1000; // every 5 minutes
-  byte DebounceMask = 0x07; // Successive readings as bits (111) or (000) to confirm float's state.
+  unsigned long MqttConfigPollMs = 60 * 60 * 1000; // every hour, while config comes over MQTT
   unsigned long MinNotifyPeriodMs = 15 * 60 * 1000; // 15 minutes
   unsigned long DryAgeNotifyMs = 12 * 60 * 60 * 1000; // 12 hours
   unsigned long MaxPumpRunTimeMs = 2 * 60 * 1000; // 2 minutes
@@ -28,25 +51,48 @@ struct ApplicationConfig {
   unsigned long PumpTestRunMinIntervalMs = 30 * 60 * 1000; // 30 minutes
   bool DebugLog = true;
   bool PostLog = true;
-
-  // evaluated fields
-  byte inverseDebounceMask = ~DebounceMask;
+  bool PowerSave = false; // Doze between samples while the sump is dry.
+  unsigned long DozeWakeCheckMs = 1000; // Fallback pin check while dozing, wake pin interrupts come first.
+  unsigned long RadioWindowMs = 5 * 60 * 1000; // Batch log posts every 5 minutes while dozing.
+  unsigned long StallLimitMs = 10 * 1000; // A loop stage running longer is recorded as stalled.
 };
 
 extern ApplicationConfig AppConfig;
 
 void log(const char* format, ...);
+void formatLog(char* buff, size_t buffLen, const char* format, va_list args);
 #define logd(...) {if(AppConfig.DebugLog) log(__VA_ARGS__);};
 char* formatMillis(char* buff, unsigned long milliseconds);
 
 bool ensureWiFi();
 bool wifiConnected();
 void updateConfig(bool force = false);
+void parseConfig(const char* json, const char* source);
 void soundAlarm(int alarmEvent = IOT_EVENT_NONE);
 void stopAlarm();
 bool checkAlarm();
 void testAlarm();
 bool sendNotification(int eventId, const char* msg = NULL, int msgLen = 0);
 void postLog(const char* logMsg);
+bool mqttConnected();
+void mqttLoop();
+bool mqttPublishEvent(const char* json, size_t jsonSize);
+bool mqttPublishLog(const char* logMsg);
+void announceFirmware(const char* version, const char* md5, const char* sketchMd5);
+bool otaInProgress();
+void otaLoop(bool canReboot);
+void updatePowerMode(bool canDoze);
+bool doze(unsigned long ms);
+void floatChangeRegistered();
+bool deferLog(const char* logMsg);
+bool radioAllowed();
+void setupWatchdog();
+byte enterStage(byte stage);
+void startLoopTiming();
+void endLoopTiming();
+const char* getPostMortem();
+#ifdef SUMP_BENCHMARK
+int runBenchmarks();
+#endif
 
 #endif // main_h
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include <Arduino.h>
+#include <chrono>
+
+HardwareSerial Serial;
+
+int mockPins[MOCK_PIN_COUNT] = { HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH,
+  HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH };
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < MOCK_PIN_COUNT ? mockPins[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if(pin < MOCK_PIN_COUNT) {
+    mockPins[pin] = value;
+  }
+}
+
+void mockPinState(uint8_t pin, int value) {
+  digitalWrite(pin, value);
+}
+
+const std::chrono::steady_clock::time_point mockBootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mockBootTime).count();
+}
+
+void delay(unsigned long ms) {
+}
+
+void yield() {
+}
+
+size_t HardwareSerial::print(const char* text) {
+  return fputs(text, stdout);
+}
+
+size_t HardwareSerial::println(const char* text) {
+  return print(text) + print("\n");
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int len = vprintf(format, args);
+  va_end(args);
+  return len;
+}
@@ -0,0 +1,68 @@
+#ifndef native_arduino_h
+#define native_arduino_h
+
+// Stand-in for the ESP8266 Arduino core, for the native_bench env.
+// Pins read what mockPinState() last set them to, HIGH by default (pulled up, floats off).
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+
+#define LOW           0
+#define HIGH          1
+#define INPUT         0x00
+#define OUTPUT        0x01
+#define INPUT_PULLUP  0x02
+
+// NodeMCU pin names
+#define D0  16
+#define D1  5
+#define D2  4
+#define D3  0
+#define D4  2
+#define D5  14
+#define D6  12
+#define D7  13
+#define D8  15
+
+#define MOCK_PIN_COUNT  17
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void mockPinState(uint8_t pin, int value);
+
+unsigned long millis();
+void delay(unsigned long ms); // Returns right away, nothing runs in the background.
+void yield();
+
+class String {
+  std::string str;
+public:
+  String(const char* cstr = "") : str(cstr) {}
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.length(); }
+};
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) {}
+  size_t print(const char* text);
+  size_t println(const char* text = "");
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+extern HardwareSerial Serial;
+
+#endif // native_arduino_h
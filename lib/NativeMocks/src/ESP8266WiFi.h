@@ -0,0 +1,35 @@
+#ifndef native_esp8266wifi_h
+#define native_esp8266wifi_h
+
+#include <Arduino.h>
+
+// Always connected, so nothing ever waits on WiFi setup.
+
+#define WL_CONNECTED    3
+#define WIFI_OFF        0
+#define WIFI_STA        1
+
+class IPAddress {
+  uint8_t octets[4] = { 127, 0, 0, 1 };
+public:
+  uint8_t operator[](int index) const { return octets[index]; }
+};
+
+class WiFiClient {
+};
+
+class MockWiFi {
+public:
+  int status() { return WL_CONNECTED; }
+  bool disconnect() { return true; }
+  void persistent(bool persistent) {}
+  bool mode(int mode) { return true; }
+  bool config(uint32_t ip, uint32_t gateway, uint32_t subnet) { return true; }
+  bool setHostname(const char* name) { return true; }
+  int begin(const char* ssid, const char* password) { return WL_CONNECTED; }
+  IPAddress localIP() { return IPAddress(); }
+  String macAddress() { return String("00:00:00:00:00:00"); }
+};
+extern MockWiFi WiFi;
+
+#endif // native_esp8266wifi_h
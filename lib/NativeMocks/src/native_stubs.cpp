@@ -0,0 +1,65 @@
+#include <Arduino.h>
+#include <main.h>
+
+// The native_bench env leaves out the modules that are all ESP8266 SDK (mqtt, ota, power,
+// watchdog). These stand in for them: no broker, no update, never dozing, nothing watched.
+
+bool mqttConnected() {
+  return false;
+}
+
+void mqttLoop() {
+}
+
+bool mqttPublishEvent(const char* json, size_t jsonSize) {
+  return false;
+}
+
+bool mqttPublishLog(const char* logMsg) {
+  return false;
+}
+
+void announceFirmware(const char* version, const char* md5, const char* sketchMd5) {
+}
+
+bool otaInProgress() {
+  return false;
+}
+
+void otaLoop(bool canReboot) {
+}
+
+void updatePowerMode(bool canDoze) {
+}
+
+bool doze(unsigned long ms) {
+  return false;
+}
+
+void floatChangeRegistered() {
+}
+
+bool deferLog(const char* logMsg) {
+  return false;
+}
+
+bool radioAllowed() {
+  return true;
+}
+
+void setupWatchdog() {
+}
+
+byte enterStage(byte stage) {
+  return LOOP_STAGE_IDLE;
+}
+
+void startLoopTiming() {
+}
+
+void endLoopTiming() {
+}
+
+const char* getPostMortem() {
+  return "";
+}
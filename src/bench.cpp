@@ -0,0 +1,314 @@
+#ifdef SUMP_BENCHMARK
+
+#include <Arduino.h>
+#include <main.h>
+#include <pins.h>
+
+#ifdef ARDUINO
+#include <umm_malloc/umm_malloc.h>
+#else
+#include <chrono>
+#include <new>
+#include <pthread.h>
+#endif
+
+// Benchmarks for the control and messaging hot paths. Prints one json line per benchmark:
+//   {"bench":"checkFloat","iterations":2000,"ns_per_op":812,"heap_bytes":0,"stack_bytes":64,...}
+//
+// native_bench env: runs on Linux against lib/NativeMocks, with every pin fixed HIGH (floats
+// off) and no network, so runs are reproducible. ns/op from the steady clock, heap_bytes is
+// what operator new handed out per op, stack_bytes the high-water mark on a painted stack.
+// Exits with 1 on a regression.
+//
+// nodemcuv2_bench env: runs once from setup(), before WiFi comes up. ns/op from
+// ESP.getCycleCount(), heap_bytes is the heap low-water mark, stack_bytes the cont stack
+// high-water mark. checkAllFloats() is skipped unless the floats are dry, since any float on
+// would send a notification. A regression keeps the red led on.
+//
+// Each benchmark is timed BENCH_REPEATS times and the fastest run counts, which keeps out
+// most of the noise from whatever else the machine is doing.
+//
+// Baselines (ns/op) come from build flags, per env, see platformio.ini. A benchmark more than
+// BENCH_REGRESSION_PCT above its baseline is a regression and fails the run. The summary
+// reports "no_baseline" only when no benchmark has one, and counts the ones missing.
+
+#ifndef BENCH_REGRESSION_PCT
+#define BENCH_REGRESSION_PCT  10
+#endif
+
+// Below this many ns over the baseline nothing counts as a regression, so the fastest
+// benchmarks don't fail on clock jitter.
+#ifndef BENCH_REGRESSION_MIN_NS
+#define BENCH_REGRESSION_MIN_NS  0
+#endif
+
+#ifndef BENCH_REPEATS
+#define BENCH_REPEATS   5
+#endif
+
+// Multiplies every benchmark's iterations. The native build sets it higher, a run takes too
+// little time there otherwise for the clock to measure it reliably.
+#ifndef BENCH_ITERATION_SCALE
+#define BENCH_ITERATION_SCALE   1
+#endif
+
+#define BENCH_JSON_LEN  1024
+
+#ifndef BENCH_BASELINE_CHECK_FLOAT
+#define BENCH_BASELINE_CHECK_FLOAT        0
+#endif
+#ifndef BENCH_BASELINE_CHECK_ALL_FLOATS
+#define BENCH_BASELINE_CHECK_ALL_FLOATS   0
+#endif
+#ifndef BENCH_BASELINE_VERIFY_FLOATS
+#define BENCH_BASELINE_VERIFY_FLOATS      0
+#endif
+#ifndef BENCH_BASELINE_FORMAT_MILLIS
+#define BENCH_BASELINE_FORMAT_MILLIS      0
+#endif
+#ifndef BENCH_BASELINE_FORMAT_LOG
+#define BENCH_BASELINE_FORMAT_LOG         0
+#endif
+#ifndef BENCH_BASELINE_EVENT_MESSAGE
+#define BENCH_BASELINE_EVENT_MESSAGE      0
+#endif
+#ifndef BENCH_BASELINE_PARSE_CONFIG
+#define BENCH_BASELINE_PARSE_CONFIG       0
+#endif
+
+void checkFloat(int floatLevel);
+bool verifyFloatsState();
+void checkAllFloats();
+
+struct NotifyMessage;
+NotifyMessage& createEventMessage(int eventId, const char* msg, int msgLen);
+size_t SerializeMessageBody(const NotifyMessage& msgBody, char* json, size_t maxSize);
+
+const char benchConfigJson[] =
+  "{\"MainLoopSec\":5,\"ActiveLoopMs\":50,\"ActiveHoldSec\":30,\"DebounceMs\":2000,\"UpdateConfigSec\":300,"
+  "\"MqttConfigPollSec\":3600,\"MinNotifyPeriodSec\":900,\"DryAgeNotifySec\":43200,\"MaxPumpRunTimeSec\":120,"
+  "\"PumpTestRunSec\":3,\"PumpTestRunMinIntervalSec\":1800,\"DebugLog\":false,\"PostLog\":false,"
+  "\"PowerSave\":false,\"DozeWakeCheckMs\":1000,\"RadioWindowSec\":300,\"StallLimitSec\":10}";
+
+char benchJson[BENCH_JSON_LEN];
+char benchMillis[24];
+volatile size_t benchSink = 0; // Keeps results from being optimized away.
+
+// What log() does before it prints and posts the line.
+void benchFormatLog(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  formatLog(benchJson, BENCH_JSON_LEN, format, args);
+  va_end(args);
+}
+
+typedef void (*BenchFn)();
+
+struct BenchCase {
+  const char* Name;
+  BenchFn Run;
+  unsigned int Iterations;
+  uint32_t BaselineNs; // ns/op from a reference run. 0 if there is none.
+  bool NeedsDryFloats;
+};
+
+BenchCase benchCases[] = {
+  { "checkFloat", []() { checkFloat(0); }, 2000, BENCH_BASELINE_CHECK_FLOAT, false },
+  { "checkAllFloats", []() { checkAllFloats(); }, 1000, BENCH_BASELINE_CHECK_ALL_FLOATS, true },
+  { "verifyFloatsState", []() { benchSink += verifyFloatsState(); }, 2000, BENCH_BASELINE_VERIFY_FLOATS, false },
+  { "formatMillis", []() { benchSink += (size_t)formatMillis(benchMillis, millis()); }, 1000, BENCH_BASELINE_FORMAT_MILLIS, false },
+  { "formatLog", []() { benchFormatLog("Floats state: [%d %d %d]", 0, 0, 0); }, 500, BENCH_BASELINE_FORMAT_LOG, false },
+  { "createEventMessage+SerializeMessageBody", []() {
+      benchSink += SerializeMessageBody(createEventMessage(IOT_EVENT_BAD_STATE, "[1 0 1]", -1), benchJson, BENCH_JSON_LEN);
+    }, 200, BENCH_BASELINE_EVENT_MESSAGE, false },
+  { "parseConfig", []() { parseConfig(benchConfigJson, "bench"); }, 100, BENCH_BASELINE_PARSE_CONFIG, false },
+};
+#define BENCH_CASE_COUNT  (sizeof(benchCases) / sizeof(benchCases[0]))
+
+unsigned int benchIterations(const BenchCase& bench) {
+  return bench.Iterations * BENCH_ITERATION_SCALE;
+}
+
+struct BenchResult {
+  uint32_t NsPerOp;
+  uint32_t HeapBytes;
+  uint32_t StackBytes;
+};
+
+#ifdef ARDUINO
+
+#define BENCH_PLATFORM  "esp8266"
+
+BenchResult measure(const BenchCase& bench) {
+  BenchResult result;
+  uint32_t heapBefore = umm_free_heap_size_min_reset();
+  ESP.resetFreeContStack();
+  uint32_t stackBefore = ESP.getFreeContStack();
+
+  uint32_t startCycles = ESP.getCycleCount();
+  for(unsigned int n = 0; n < benchIterations(bench); n++) {
+    bench.Run();
+  }
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+
+  result.StackBytes = stackBefore - ESP.getFreeContStack();
+  result.HeapBytes = heapBefore - umm_free_heap_size_min();
+  result.NsPerOp = (uint32_t)((uint64_t)cycles * 1000 / ESP.getCpuFreqMHz() / benchIterations(bench));
+  yield();
+  return result;
+}
+
+bool floatsDry() {
+  return digitalRead(FLOAT_SUMP_PIN) != 0 && digitalRead(FLOAT_BACKUP_PIN) != 0 && digitalRead(FLOAT_FLOOD_PIN) != 0;
+}
+
+#else // ARDUINO
+
+#define BENCH_PLATFORM      "native"
+#define BENCH_STACK_LEN     (256 * 1024)
+#define BENCH_STACK_PAINT   0xa5
+
+size_t benchHeapBytes = 0;
+
+void* operator new(size_t size) {
+  benchHeapBytes += size;
+  void* ptr = malloc(size);
+  if(NULL == ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+struct BenchRun {
+  const BenchCase* Bench;
+  uint64_t Ns;
+  size_t HeapBytes;
+};
+
+void* benchThread(void* arg) {
+  BenchRun* run = (BenchRun*)arg;
+  if(NULL == run->Bench) {
+    // Empty run, to measure what the thread itself uses of the stack.
+    return NULL;
+  }
+
+  size_t heapBefore = benchHeapBytes;
+  auto start = std::chrono::steady_clock::now();
+  for(unsigned int n = 0; n < benchIterations(*run->Bench); n++) {
+    run->Bench->Run();
+  }
+  run->Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  run->HeapBytes = benchHeapBytes - heapBefore;
+  return NULL;
+}
+
+// Runs the benchmark on a freshly painted stack, returns how much of the stack got used.
+size_t runOnPaintedStack(BenchRun& run) {
+  uint8_t* stack = NULL;
+  if(0 != posix_memalign((void**)&stack, 4096, BENCH_STACK_LEN)) {
+    return 0;
+  }
+  memset(stack, BENCH_STACK_PAINT, BENCH_STACK_LEN);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, BENCH_STACK_LEN);
+  pthread_t thread;
+  if(0 == pthread_create(&thread, &attr, benchThread, &run)) {
+    pthread_join(thread, NULL);
+  }
+  pthread_attr_destroy(&attr);
+
+  // The stack grows down, the untouched bytes are at the bottom.
+  size_t untouched = 0;
+  while(untouched < BENCH_STACK_LEN && stack[untouched] == BENCH_STACK_PAINT) {
+    untouched++;
+  }
+  free(stack);
+  return BENCH_STACK_LEN - untouched;
+}
+
+BenchResult measure(const BenchCase& bench) {
+  BenchRun empty = { NULL, 0, 0 };
+  size_t threadStack = runOnPaintedStack(empty);
+
+  BenchRun run = { &bench, 0, 0 };
+  size_t stack = runOnPaintedStack(run);
+
+  BenchResult result;
+  result.NsPerOp = (uint32_t)(run.Ns / benchIterations(bench));
+  result.HeapBytes = run.HeapBytes / benchIterations(bench);
+  result.StackBytes = stack > threadStack ? stack - threadStack : 0;
+  return result;
+}
+
+bool floatsDry() {
+  return true; // Pins are mocked HIGH.
+}
+
+#endif // ARDUINO
+
+bool runBenchmark(const BenchCase& bench) {
+  if(bench.NeedsDryFloats && !floatsDry()) {
+    Serial.printf("{\"bench\":\"%s\",\"skipped\":\"floats not dry\"}\n", bench.Name);
+    return false;
+  }
+
+  BenchResult result = measure(bench);
+  for(int n = 1; n < BENCH_REPEATS; n++) {
+    BenchResult repeat = measure(bench);
+    result.NsPerOp = min(result.NsPerOp, repeat.NsPerOp);
+    result.HeapBytes = max(result.HeapBytes, repeat.HeapBytes);
+    result.StackBytes = max(result.StackBytes, repeat.StackBytes);
+  }
+  bool regression = bench.BaselineNs > 0
+    && result.NsPerOp > bench.BaselineNs * (100 + BENCH_REGRESSION_PCT) / 100
+    && result.NsPerOp > bench.BaselineNs + BENCH_REGRESSION_MIN_NS;
+
+  Serial.printf("{\"bench\":\"%s\",\"iterations\":%u,\"ns_per_op\":%u,\"heap_bytes\":%u,\"stack_bytes\":%u,"
+    "\"baseline_ns\":%u,\"regression\":%s}\n",
+    bench.Name, benchIterations(bench), (unsigned int)result.NsPerOp, (unsigned int)result.HeapBytes,
+    (unsigned int)result.StackBytes, (unsigned int)bench.BaselineNs, regression ? "true" : "false");
+  return regression;
+}
+
+int runBenchmarks() {
+  // Keep the network and the config out of the measurements.
+  ApplicationConfig savedConfig = AppConfig;
+  AppConfig.DebugLog = false;
+  AppConfig.PostLog = false;
+
+  int regressions = 0;
+  int missingBaselines = 0;
+  for(size_t n = 0; n < BENCH_CASE_COUNT; n++) {
+    regressions += runBenchmark(benchCases[n]);
+    missingBaselines += (benchCases[n].BaselineNs == 0);
+  }
+
+  const char* result = regressions > 0 ? "fail" : (missingBaselines == (int)BENCH_CASE_COUNT ? "no_baseline" : "pass");
+  Serial.printf("{\"bench_summary\":{\"result\":\"%s\",\"platform\":\"%s\",\"count\":%u,\"regressions\":%d,"
+    "\"missing_baselines\":%d,\"threshold_pct\":%d}}\n",
+    result, BENCH_PLATFORM, (unsigned int)BENCH_CASE_COUNT, regressions, missingBaselines, BENCH_REGRESSION_PCT);
+  if(regressions > 0) {
+    digitalWrite(LED_RED_PIN, 0); // on, until something else turns it off.
+  }
+
+  AppConfig = savedConfig;
+  return regressions;
+}
+
+#ifndef ARDUINO
+int main() {
+  return runBenchmarks() > 0 ? 1 : 0;
+}
+#endif
+
+#endif // SUMP_BENCHMARK
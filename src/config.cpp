@@ -24,7 +24,7 @@ void updateValue(const JsonObject &jconfig, const char* key, T &currentValue) {
   }
 }
 
-void parseConfig(const char* json) {
+void parseConfig(const char* json, const char* source) {
   StaticJsonBuffer<1024> jsonBuffer;
   JsonObject& config = jsonBuffer.parseObject(json);
   if (!config.success()) {
@@ -32,8 +32,11 @@ void parseConfig(const char* json) {
   }
 
   updateValue(config, "MainLoopSec", AppConfig.MainLoopMs, 1000);
+  updateValue(config, "ActiveLoopMs", AppConfig.ActiveLoopMs);
+  updateValue(config, "ActiveHoldSec", AppConfig.ActiveHoldMs, 1000);
+  updateValue(config, "DebounceMs", AppConfig.DebounceMs);
   updateValue(config, "UpdateConfigSec", AppConfig.UpdateConfigMs, 1000);
-  updateValue(config, "DebounceMask", AppConfig.DebounceMask);
+  updateValue(config, "MqttConfigPollSec", AppConfig.MqttConfigPollMs, 1000);
   updateValue(config, "MinNotifyPeriodSec", AppConfig.MinNotifyPeriodMs, 1000);
   updateValue(config, "DryAgeNotifySec", AppConfig.DryAgeNotifyMs, 1000);
   updateValue(config, "MaxPumpRunTimeSec", AppConfig.MaxPumpRunTimeMs, 1000);
@@ -41,17 +44,28 @@ void parseConfig(const char* json) {
   updateValue(config, "PumpTestRunMinIntervalSec", AppConfig.PumpTestRunMinIntervalMs, 1000);
   updateValue(config, "DebugLog", AppConfig.DebugLog);
   updateValue(config, "PostLog", AppConfig.PostLog);
+  updateValue(config, "PowerSave", AppConfig.PowerSave);
+  updateValue(config, "DozeWakeCheckMs", AppConfig.DozeWakeCheckMs);
+  updateValue(config, "RadioWindowSec", AppConfig.RadioWindowMs, 1000);
+  updateValue(config, "StallLimitSec", AppConfig.StallLimitMs, 1000);
 
-  AppConfig.inverseDebounceMask = ~AppConfig.DebounceMask;
+  if (config.containsKey("FirmwareVersion")) {
+    announceFirmware(config["FirmwareVersion"].as<const char*>(), config["FirmwareMd5"].as<const char*>(),
+      config["FirmwareSketchMd5"].as<const char*>());
+  }
 
-  logd("Configuration pulled from %s", CONFIG_URL);
+  logd("Configuration pulled from %s", source);
   logd(json);
 }
 
 unsigned long lastConfigUpdate = 0;
 void updateConfig(bool force) {
+  // With MQTT up the broker pushes retained config as soon as it changes. The slow http poll
+  // is a safety net, for changes made on the service that didn't make it to the broker.
+  unsigned long period = mqttConnected() ? AppConfig.MqttConfigPollMs : AppConfig.UpdateConfigMs;
+
   unsigned long now = millis();
-  if(!force && (now - lastConfigUpdate < AppConfig.UpdateConfigMs)) {
+  if(!force && (now - lastConfigUpdate < period || !radioAllowed())) {
     return;
   }
   if(force) {
@@ -65,7 +79,7 @@ void updateConfig(bool force) {
     int code = httpClient.GET();
     if(code == 200) {
       String body = httpClient.getString();
-      parseConfig(body.c_str());
+      parseConfig(body.c_str(), CONFIG_URL);
     }
     else {
       log("Cannot pull config from %s. Http code %d", CONFIG_URL, code);
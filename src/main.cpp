@@ -2,6 +2,11 @@
 #include <main.h>
 #include <pins.h>
 
+#ifndef SUMP_MONITOR_VERSION
+#error "Set SUMP_MONITOR_VERSION in build_flags, see platformio.ini."
+#endif
+const char SumpMonitorVersion[] = SUMP_MONITOR_VERSION;
+
 #define FLOAT_LEVEL_SUMP    0
 #define FLOAT_LEVEL_BACKUP  1
 #define FLOAT_LEVEL_FLOOD   2
@@ -46,17 +51,22 @@ char* formatMillis(char* buff, unsigned long milliseconds) {
 #define LOG_BUFF_LEN 600
 char logMsgBuffer[LOG_BUFF_LEN];
 char millisFmtBuffer[24];
-void log(const char* format, ...)
+// Timestamped log line, without sending it anywhere.
+void formatLog(char* buff, size_t buffLen, const char* format, va_list args)
 {
-  va_list args;
-  va_start(args, format);
-
   size_t txtLen;
 
-  txtLen = snprintf(logMsgBuffer, LOG_BUFF_LEN, "%s ", formatMillis(millisFmtBuffer, millis()));
-  vsnprintf(logMsgBuffer + txtLen, LOG_BUFF_LEN - txtLen, format, args);
+  txtLen = snprintf(buff, buffLen, "%s ", formatMillis(millisFmtBuffer, millis()));
+  vsnprintf(buff + txtLen, buffLen - txtLen, format, args);
+}
 
+void log(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  formatLog(logMsgBuffer, LOG_BUFF_LEN, format, args);
   va_end(args);
+
   Serial.println(logMsgBuffer);
   postLog(logMsgBuffer);
 }
@@ -81,10 +91,15 @@ void setupIO() {
 
 struct FloatData {
   byte Pin;
-  byte DebounceBits = 0x00;
+  bool Reading = 0; // Last raw reading of the switch.
+  unsigned long ReadingSince = 0; // When the raw reading last changed.
   bool On = 0;
   bool LoggedState = 0;
 
+  bool settled() {
+    return Reading == On;
+  }
+
   bool stateChanged() {
     return On != LoggedState;
   }
@@ -109,35 +124,26 @@ const char* getFloatsState() {
   return floatsState;
 }
 
-byte inverseDebounceMask = ~AppConfig.DebounceMask;
-
 void checkFloat(int floatLevel) {
   FloatData& fdata = floats[floatLevel];
-  fdata.DebounceBits = fdata.DebounceBits << 1;
-  int pinVal = digitalRead(fdata.Pin);
-  if(pinVal == 0) {
-    // Pin is pulled up. Will read 0 when float switch is on.
-    fdata.DebounceBits += 1;
-  }
+  unsigned long now = millis();
 
-  // So many consequtive times the switch was read as ON.
-  if(AppConfig.DebounceMask == (fdata.DebounceBits & AppConfig.DebounceMask)) {
-    fdata.On = true;
+  // Pin is pulled up. Will read 0 when float switch is on.
+  bool reading = (digitalRead(fdata.Pin) == 0);
+  if(reading != fdata.Reading) {
+    fdata.Reading = reading;
+    fdata.ReadingSince = now;
   }
 
-  // So many consequtive times the switch was read as OFF.
-  if(inverseDebounceMask == (fdata.DebounceBits | inverseDebounceMask)) {
-    fdata.On = false;
+  // The switch has been reading the same for long enough, regardless of how often it was sampled.
+  if(!fdata.settled() && (now - fdata.ReadingSince >= AppConfig.DebounceMs)) {
+    fdata.On = fdata.Reading;
   }
 
   return;
 }
 
 bool verifyFloatsState() {
-  snprintf(floatsState, TXT_FLOAT_STATE_LEN, "[%d %d %d]",
-    floats[FLOAT_LEVEL_SUMP].DebounceBits, floats[FLOAT_LEVEL_BACKUP].DebounceBits, floats[FLOAT_LEVEL_FLOOD].DebounceBits);
-  logd("Debounce bits: %s", floatsState);
-
   for(int lvl = FLOAT_LEVEL_COUNT - 1; lvl > 0; lvl--) {
     if(floats[lvl].On && !floats[lvl-1].On) {
       return false;
@@ -228,7 +234,10 @@ void checkAllFloats() {
 
   if(!verifyFloatsState()) {
     const char* floatStates = getFloatsState();
-    log("Invalid floats state: %s.", floatStates);
+    if(floatStateChanged()) {
+      // Sampling can be fast, only log when the bad state is new.
+      log("Invalid floats state: %s.", floatStates);
+    }
     sendNotification(IOT_EVENT_BAD_STATE, floatStates, -1);
     soundAlarm(IOT_EVENT_BAD_STATE);
   }
@@ -248,9 +257,35 @@ void checkAllFloats() {
 
   drivePump();
 
+  if(floatStateChanged()) {
+    floatChangeRegistered(); // For the reaction latency after waking from a doze.
+  }
+
   logFloatsState();
 }
 
+// Sample fast while anything is going on, slow down once the sump has been quiet for a while.
+unsigned long lastActivity = 0;
+unsigned long samplingPeriodMs = 0;
+void adjustSamplingRate() {
+
+  bool active = (execMode == Pumping);
+  for(int lvl = 0; lvl < FLOAT_LEVEL_COUNT; lvl++) {
+    active = active || !floats[lvl].settled();
+  }
+
+  unsigned long now = millis();
+  if(active) {
+    lastActivity = now;
+  }
+
+  unsigned long period = (now - lastActivity < AppConfig.ActiveHoldMs) ? AppConfig.ActiveLoopMs : AppConfig.MainLoopMs;
+  if(period != samplingPeriodMs) {
+    logd("Sampling every %lu ms.", period);
+    samplingPeriodMs = period;
+  }
+}
+
 void runTest() {
   testAlarm();
   testPump();
@@ -282,34 +317,49 @@ void setup() {
 
   log("\nSetting up...");
 
+  setupWatchdog();
   setupIO();
+#ifdef SUMP_BENCHMARK
+  runBenchmarks();
+#endif
   ensureWiFi();
 
   updateConfig(true);
 
   execMode = Monitoring;
 
-  log("Ready. Version: " SUMP_MONITOR_VERSION);
+  log("Ready. Version: %s", SumpMonitorVersion);
+  enterStage(LOOP_STAGE_IDLE);
 }
 
 unsigned long lastLoopRun = 0;
 bool resetNotificationSent = false;
 bool flipBlueLed = false;
+bool wokenUp = false;
 void loop() {
 
-  if(millis() - lastLoopRun > AppConfig.MainLoopMs) {
+  if(wokenUp || millis() - lastLoopRun >= samplingPeriodMs) {
+    wokenUp = false;
+    startLoopTiming();
 
     if(!resetNotificationSent) {
       // Here because sometimes wifi is not ready in startup.
-      resetNotificationSent = sendNotification(IOT_EVENT_RESET);
+      enterStage(LOOP_STAGE_RESET_NOTIFY);
+      resetNotificationSent = sendNotification(IOT_EVENT_RESET, getPostMortem(), -1);
     }
 
+    enterStage(LOOP_STAGE_CONFIG);
     updateConfig();
 
+    enterStage(LOOP_STAGE_BUTTON);
     checkButtonPress();
 
+    enterStage(LOOP_STAGE_FLOATS);
     checkAllFloats(); // Gist of the work.
 
+    adjustSamplingRate();
+
+    enterStage(LOOP_STAGE_ALARM);
     soundAlarm(); // Keeps the alarms going on if needed.
 
     if(wifiConnected()) {
@@ -321,7 +371,23 @@ void loop() {
     }
 
     lastLoopRun = millis();
+    endLoopTiming();
   }
 
-  yield();
+  enterStage(LOOP_STAGE_MQTT);
+  mqttLoop(); // Keeps the broker session alive between samples.
+
+  enterStage(LOOP_STAGE_OTA);
+  otaLoop(execMode == Monitoring && !checkAlarm()); // Only reboot into new firmware while nothing is going on.
+
+  bool idle = sumpConsideredDry && execMode == Monitoring && !checkAlarm() && !otaInProgress()
+    && samplingPeriodMs == AppConfig.MainLoopMs;
+  enterStage(LOOP_STAGE_POWER);
+  updatePowerMode(idle);
+
+  unsigned long sinceLastRun = millis() - lastLoopRun;
+  // A float or the button woke us up, sample right away.
+  enterStage(LOOP_STAGE_DOZE);
+  wokenUp = doze(sinceLastRun < samplingPeriodMs ? samplingPeriodMs - sinceLastRun : 0);
+  enterStage(LOOP_STAGE_IDLE);
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <main.h>
+
+#ifdef MQTT_BROKER_FQDN
+
+#include <MQTT.h>
+
+#define MQTT_TOPIC_BASE       "iot/" DEVICE_ID
+#define MQTT_EVENT_TOPIC      MQTT_TOPIC_BASE "/event"
+#define MQTT_LOG_TOPIC        MQTT_TOPIC_BASE "/log"
+#define MQTT_CONFIG_TOPIC     MQTT_TOPIC_BASE "/config"
+#define MQTT_STATUS_TOPIC     MQTT_TOPIC_BASE "/status"
+
+#define MQTT_QOS_LOG          0 // Logs are best effort.
+#define MQTT_QOS_EVENT        1 // Events must get to the broker.
+#define MQTT_KEEP_ALIVE_SEC   60
+#define MQTT_TIMEOUT_MS       2000
+#define MQTT_CONNECT_TIMEOUT_MS   1000 // TCP connect, loop() is blocked meanwhile.
+#define MQTT_RECONNECT_MS         (30 * 1000) // 30 seconds, doubling on every failure
+#define MQTT_RECONNECT_MAX_MS     (15 * 60 * 1000) // up to 15 minutes
+
+#define MQTT_BUFF_LEN         1280
+#define CONFIG_BUFF_LEN       1024
+
+WiFiClient mqttNetClient;
+MQTTClient mqttClient(MQTT_BUFF_LEN);
+
+// Config arrives in the client's callback, where publishing (and so logging) is not safe.
+// Hold on to it until the next mqttLoop().
+char pendingConfig[CONFIG_BUFF_LEN];
+bool configPending = false;
+
+void onMqttMessage(MQTTClient* client, char topic[], char bytes[], int length) {
+  if(0 != strcmp(topic, MQTT_CONFIG_TOPIC) || length <= 0) {
+    return;
+  }
+  if(length >= CONFIG_BUFF_LEN) {
+    Serial.printf("MQTT config too long: %d bytes.\n", length);
+    return;
+  }
+  memcpy(pendingConfig, bytes, length);
+  pendingConfig[length] = '\0';
+  configPending = true;
+}
+
+bool mqttConnected() {
+  return mqttClient.connected();
+}
+
+unsigned long lastMqttConnect = 0;
+unsigned long mqttReconnectMs = MQTT_RECONNECT_MS;
+bool mqttConnect() {
+  unsigned long now = millis();
+  if(!radioAllowed() || (lastMqttConnect != 0 && (now - lastMqttConnect < mqttReconnectMs))) {
+    return false;
+  }
+  lastMqttConnect = now;
+
+  mqttNetClient.setTimeout(MQTT_CONNECT_TIMEOUT_MS);
+  mqttClient.begin(MQTT_BROKER_FQDN, MQTT_BROKER_PORT, mqttNetClient);
+  mqttClient.onMessageAdvanced(onMqttMessage);
+  // Persistent session: the broker keeps our subscription and queued QoS1 messages across reconnects.
+  mqttClient.setOptions(MQTT_KEEP_ALIVE_SEC, false, MQTT_TIMEOUT_MS);
+  mqttClient.setWill(MQTT_STATUS_TOPIC, "offline", true, MQTT_QOS_EVENT);
+
+  if(!mqttClient.connect(DEVICE_ID)) {
+    // Each attempt stalls loop(), don't keep at it while the broker is down.
+    mqttReconnectMs = min(mqttReconnectMs * 2, (unsigned long)MQTT_RECONNECT_MAX_MS);
+    log("Cannot connect to MQTT broker %s. Error %d, return code %d. Next try in %lu sec.",
+      MQTT_BROKER_FQDN, mqttClient.lastError(), mqttClient.returnCode(), mqttReconnectMs / 1000);
+    return false;
+  }
+  mqttReconnectMs = MQTT_RECONNECT_MS;
+
+  mqttClient.publish(MQTT_STATUS_TOPIC, "online", true, MQTT_QOS_EVENT);
+  // Even with a session present: subscribing again makes the broker resend the retained config.
+  mqttClient.subscribe(MQTT_CONFIG_TOPIC, MQTT_QOS_EVENT);
+  log("Connected to MQTT broker %s.", MQTT_BROKER_FQDN);
+  return true;
+}
+
+void mqttLoop() {
+  if(!mqttClient.connected()) {
+    if(!wifiConnected() || !mqttConnect()) {
+      return;
+    }
+  }
+
+  mqttClient.loop();
+
+  if(configPending) {
+    configPending = false;
+    parseConfig(pendingConfig, "mqtt://" MQTT_BROKER_FQDN "/" MQTT_CONFIG_TOPIC);
+  }
+}
+
+bool mqttPublishEvent(const char* json, size_t jsonSize) {
+  if(!mqttClient.connected()) {
+    return false;
+  }
+  return mqttClient.publish(MQTT_EVENT_TOPIC, json, jsonSize, false, MQTT_QOS_EVENT);
+}
+
+bool mqttPublishLog(const char* logMsg) {
+  // NOTE: called from postLog(), do not call log() here.
+  if(!mqttClient.connected()) {
+    return false;
+  }
+  return mqttClient.publish(MQTT_LOG_TOPIC, logMsg, strlen(logMsg), false, MQTT_QOS_LOG);
+}
+
+#else // MQTT_BROKER_FQDN
+
+// No broker configured, everything goes over http.
+bool mqttConnected() {
+  return false;
+}
+
+void mqttLoop() {
+}
+
+bool mqttPublishEvent(const char* json, size_t jsonSize) {
+  return false;
+}
+
+bool mqttPublishLog(const char* logMsg) {
+  return false;
+}
+
+#endif // MQTT_BROKER_FQDN
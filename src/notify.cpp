@@ -72,6 +72,10 @@ NotifyMessage& createEventMessage(int eventId, const char* msg = NULL, int msgLe
   if(msgLen == -1) {
     msgLen = strlen(msg);
   }
+  int msgSpace = MSG_MESSAGE_LEN - strlen(EventMessage.Message) - 1;
+  if(msgLen > msgSpace) {
+    msgLen = msgSpace;
+  }
   if(msgLen > 0) {
     strncat(EventMessage.Message, msg, msgLen);
   }
@@ -90,7 +94,8 @@ char msgBuffer[MSG_MESSAGE_LEN];
 bool sendNotification(int eventId, const char* msg, int msgLen) {
 
   unsigned long now = millis();
-  if((eventId == lastNotifiedEventId) && (now - lastNotifyTime < AppConfig.MinNotifyPeriodMs)) {
+  // RESET is retried from loop() until it gets through, and carries the post-mortem.
+  if((eventId != IOT_EVENT_RESET) && (eventId == lastNotifiedEventId) && (now - lastNotifyTime < AppConfig.MinNotifyPeriodMs)) {
     return true;
   }
   lastNotifyTime = now;
@@ -114,6 +119,11 @@ bool sendNotification(int eventId, const char* msg, int msgLen) {
   NotifyMessage& msgToSend = createEventMessage(eventId, msgBuffer, msgLen);
   size_t jsonSize = SerializeMessageBody(msgToSend, jsonText, JSON_BUFFER_SIZE);
 
+  if(mqttPublishEvent(jsonText, jsonSize)) {
+    logd("Notification published.\n%s", jsonText);
+    return true;
+  }
+
   bool result = false;
 
   httpClient.begin(wifiClient, NOTIFY_URL);
@@ -140,6 +150,14 @@ void postLog(const char* logMsg) {
     return;
   }
 
+  if(deferLog(logMsg)) {
+    return;
+  }
+
+  if(mqttPublishLog(logMsg)) {
+    return;
+  }
+
   if(!wifiConnected()) {
     // can't use log() calls here
     Serial.println("Cannot post log: no wifi.");
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <ESP8266HTTPClient.h>
+#include <Updater.h>
+#include <main.h>
+
+// Pull based firmware update. The service announces a version in the /config response, with
+// the md5 of the gzip'd image it serves from /firmware (FirmwareMd5), and the md5 of the
+// image once inflated (FirmwareSketchMd5). The latter is what ESP.getSketchMD5() reports
+// once the image runs, so an image already running is never flashed again. The image is streamed into the
+// update partition a chunk at a time from loop(), so the floats and the pump keep being
+// handled while it downloads. The bootloader inflates the image when it gets installed.
+
+#define FIRMWARE_URL    IOT_API_BASE_URL "/firmware?deviceid=" DEVICE_ID
+
+#define OTA_CHUNK_LEN         1024
+#define OTA_SLICE_MS          20 // Time given to the download on each loop() pass.
+#define OTA_STALL_MS          (30 * 1000) // 30 seconds without data aborts the download.
+#define OTA_PROGRESS_BYTES    (64 * 1024)
+
+#define FW_VERSION_LEN  40
+#define FW_MD5_LEN      33 // 32 hex digits
+
+enum OtaState {
+  OtaIdle,
+  OtaPending,
+  OtaDownloading,
+  OtaReady,
+};
+OtaState otaState = OtaIdle;
+
+HTTPClient otaHttpClient;
+WiFiClient otaNetClient;
+
+char announcedVersion[FW_VERSION_LEN] = "";
+char announcedMd5[FW_MD5_LEN] = "";
+char failedVersion[FW_VERSION_LEN] = ""; // Don't keep retrying a broken image until the next reset.
+
+uint8_t otaChunk[OTA_CHUNK_LEN];
+size_t otaExpected = 0;
+size_t otaReceived = 0;
+unsigned long otaLastData = 0;
+
+bool validMd5(const char* md5) {
+  return NULL != md5 && strlen(md5) == FW_MD5_LEN - 1;
+}
+
+void announceFirmware(const char* version, const char* md5, const char* sketchMd5) {
+  if(NULL == version || '\0' == version[0] || otaState != OtaIdle) {
+    return;
+  }
+  if(0 == strcmp(version, SumpMonitorVersion) || 0 == strcmp(version, failedVersion)) {
+    return;
+  }
+  if(!validMd5(md5) || !validMd5(sketchMd5)) {
+    log("Firmware %s announced without valid md5s, ignored.", version);
+    return;
+  }
+  if(ESP.getSketchMD5().equalsIgnoreCase(sketchMd5)) {
+    // Same image, under a version string that doesn't match ours.
+    logd("Firmware %s (sketch md5 %s) is already running.", version, sketchMd5);
+    return;
+  }
+
+  strncpy(announcedVersion, version, FW_VERSION_LEN);
+  announcedVersion[FW_VERSION_LEN - 1] = '\0';
+  strcpy(announcedMd5, md5);
+  otaState = OtaPending;
+  log("Firmware %s announced. Running %s", announcedVersion, SumpMonitorVersion);
+}
+
+void otaFail(const char* reason) {
+  log("Firmware %s update failed: %s", announcedVersion, reason);
+  if(Update.isRunning()) {
+    Update.end(); // Discards the partial image.
+  }
+  otaHttpClient.end();
+  strcpy(failedVersion, announcedVersion);
+  otaState = OtaIdle;
+}
+
+void otaBegin() {
+  otaHttpClient.setTimeout(4000);
+  otaHttpClient.begin(otaNetClient, FIRMWARE_URL);
+  int code = otaHttpClient.GET();
+  if(code != 200) {
+    log("Cannot pull firmware from %s. Http code %d", FIRMWARE_URL, code);
+    otaFail("download refused");
+    return;
+  }
+
+  int size = otaHttpClient.getSize();
+  if(size <= 0) {
+    otaFail("unknown image size");
+    return;
+  }
+  if(!Update.begin(size)) {
+    otaFail(Update.getErrorString().c_str());
+    return;
+  }
+  Update.setMD5(announcedMd5);
+
+  otaExpected = size;
+  otaReceived = 0;
+  otaLastData = millis();
+  otaState = OtaDownloading;
+  log("Downloading firmware %s, %d bytes.", announcedVersion, size);
+}
+
+void otaStep() {
+  WiFiClient* stream = otaHttpClient.getStreamPtr();
+  unsigned long sliceStart = millis();
+
+  while(otaReceived < otaExpected && millis() - sliceStart < OTA_SLICE_MS) {
+    size_t avail = stream->available();
+    if(avail == 0) {
+      break;
+    }
+    size_t len = stream->read(otaChunk, min(avail, (size_t)OTA_CHUNK_LEN));
+    if(Update.write(otaChunk, len) != len) {
+      otaFail(Update.getErrorString().c_str());
+      return;
+    }
+    if((otaReceived + len) / OTA_PROGRESS_BYTES != otaReceived / OTA_PROGRESS_BYTES) {
+      logd("Firmware download: %u of %u bytes.", otaReceived + len, otaExpected);
+    }
+    otaReceived += len;
+    otaLastData = millis();
+  }
+
+  if(otaReceived >= otaExpected) {
+    otaHttpClient.end();
+    // Verifies the md5 of what was written.
+    if(!Update.end()) {
+      otaFail(Update.getErrorString().c_str());
+      return;
+    }
+    otaState = OtaReady;
+    log("Firmware %s downloaded and verified.", announcedVersion);
+    return;
+  }
+
+  if(millis() - otaLastData > OTA_STALL_MS) {
+    otaFail("download stalled");
+  }
+}
+
+bool otaInProgress() {
+  return otaState == OtaDownloading || otaState == OtaReady;
+}
+
+void otaLoop(bool canReboot) {
+  switch(otaState) {
+    case OtaPending:
+      if(wifiConnected() && radioAllowed()) {
+        otaBegin();
+      }
+      break;
+    case OtaDownloading:
+      otaStep();
+      break;
+    case OtaReady:
+      if(canReboot) {
+        log("Rebooting into firmware %s.", announcedVersion);
+        delay(100);
+        ESP.restart();
+      }
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,263 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <coredecls.h>
+#include <main.h>
+#include <pins.h>
+
+extern "C" {
+#include <user_interface.h>
+}
+
+// While the sump is dry the monitor dozes between samples: the radio goes into modem sleep
+// and the cpu into light sleep, waking up for the beacons it has to listen to, for the next
+// sample, or when a float or the button pulls its pin low. Log posts, config polls and
+// firmware downloads wait for a radio window, opened every RadioWindowMs. Notifications
+// still go out right away.
+
+// Rough module currents, for sizing backup power. Board regulator and usb chip not included.
+// Time spent dozing can't be split into light sleep and the wakes in between (beacons, pin
+// checks), so the estimate is a range: all of it in light sleep, or all of it in modem sleep.
+#define CURRENT_AWAKE_MA        80.0 // cpu running, radio on
+#define CURRENT_LIGHT_SLEEP_MA  2.0  // auto light sleep, listening to every third beacon
+#define CURRENT_MODEM_SLEEP_MA  15.0 // cpu running, radio asleep between beacons
+#define SUPPLY_VOLTAGE          3.3
+#define DOZE_LISTEN_INTERVAL    3
+#define ENERGY_REPORT_MS        (60 * 60 * 1000) // every hour
+#define RADIO_WINDOW_MARGIN_MS  500 // On top of a sampling period, so one full pass runs in the window.
+
+#define LOG_BACKLOG_LEN   1536
+
+const byte wakePins[] = { FLOAT_SUMP_PIN, FLOAT_BACKUP_PIN, FLOAT_FLOOD_PIN, BUTTON_TEST_PIN };
+#define WAKE_PIN_COUNT  (sizeof(wakePins) / sizeof(wakePins[0]))
+
+bool dozing = false;
+WiFiSleepType_t awakeSleepMode = WIFI_MODEM_SLEEP;
+
+char logBacklog[LOG_BACKLOG_LEN];
+size_t logBacklogLen = 0;
+bool flushingLogs = false;
+unsigned long lastRadioWindow = 0;
+bool radioWindowOpen = false;
+
+// Set by the wake pin interrupt.
+volatile bool wakeEdge = false;
+volatile unsigned long wakeEdgeTime = 0;
+
+// Energy and wake latency accounting, reset every report.
+unsigned long reportStart = 0;
+unsigned long dozeMs = 0;
+unsigned long lastWakeCheck = 0;
+unsigned int wakeCount = 0;
+
+// Reaction latency: from the wake edge (or, if the interrupt was missed, the last pin check that
+// still saw every pin high) to the first sample that registers a float change.
+unsigned long pendingWakeSince = 0;
+bool wakePending = false;
+unsigned long maxReactionMs = 0;
+unsigned int reactionCount = 0;
+
+bool wakePinLow() {
+  for(size_t n = 0; n < WAKE_PIN_COUNT; n++) {
+    if(digitalRead(wakePins[n]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void flushLogBacklog() {
+  if(logBacklogLen == 0) {
+    return;
+  }
+  flushingLogs = true;
+  postLog(logBacklog);
+  flushingLogs = false;
+  logBacklogLen = 0;
+  logBacklog[0] = '\0';
+}
+
+bool deferLog(const char* logMsg) {
+  // NOTE: called from postLog(), do not call log() here.
+  if(!dozing || flushingLogs || radioWindowOpen) {
+    return false;
+  }
+
+  size_t len = strlen(logMsg);
+  if(logBacklogLen + len + 2 > LOG_BACKLOG_LEN) {
+    flushLogBacklog();
+    if(len + 2 > LOG_BACKLOG_LEN) {
+      return false;
+    }
+  }
+  if(logBacklogLen > 0) {
+    logBacklog[logBacklogLen++] = '\n';
+  }
+  memcpy(logBacklog + logBacklogLen, logMsg, len + 1);
+  logBacklogLen += len;
+  return true;
+}
+
+bool radioAllowed() {
+  return !dozing || radioWindowOpen;
+}
+
+// Light sleep only wakes up on a pin level, not an edge. The interrupt is armed as low level
+// with wake up enabled, and disarms its pin the first time it fires, which makes it behave
+// like a falling edge. doze() arms the pins that are high, and disarms them all when done.
+IRAM_ATTR void onWakePin(void* arg) {
+  byte pin = (byte)(uintptr_t)arg;
+  GPC(pin) &= ~(0xF << GPCI);
+  if(!wakeEdge) {
+    wakeEdgeTime = millis();
+    wakeEdge = true;
+  }
+  esp_schedule(); // Ends the esp_delay() in doze() right away.
+}
+
+void armWakePins() {
+  wakeEdge = false;
+  for(size_t n = 0; n < WAKE_PIN_COUNT; n++) {
+    // Floats and the button pull their pins low when they turn on.
+    if(digitalRead(wakePins[n]) != 0) {
+      attachInterruptArg(digitalPinToInterrupt(wakePins[n]), onWakePin, (void*)(uintptr_t)wakePins[n], ONLOW_WE);
+    }
+  }
+}
+
+void disarmWakePins() {
+  for(size_t n = 0; n < WAKE_PIN_COUNT; n++) {
+    detachInterrupt(digitalPinToInterrupt(wakePins[n]));
+  }
+}
+
+void enterDoze() {
+  awakeSleepMode = WiFi.getSleepMode();
+  WiFi.setSleepMode(WIFI_LIGHT_SLEEP, DOZE_LISTEN_INTERVAL);
+  dozing = true;
+  radioWindowOpen = false;
+  lastRadioWindow = millis();
+  logd("Dozing until the sump gets water.");
+}
+
+void leaveDoze() {
+  WiFi.setSleepMode(awakeSleepMode);
+  dozing = false;
+  radioWindowOpen = false;
+  flushLogBacklog();
+  logd("Awake.");
+}
+
+void updateRadioWindow() {
+  unsigned long now = millis();
+  if(radioWindowOpen) {
+    if(now - lastRadioWindow > AppConfig.MainLoopMs + RADIO_WINDOW_MARGIN_MS) {
+      radioWindowOpen = false;
+    }
+    return;
+  }
+  if(now - lastRadioWindow >= AppConfig.RadioWindowMs) {
+    // Stays open for the next sampling pass, where config gets polled and downloads start.
+    radioWindowOpen = true;
+    lastRadioWindow = now;
+    flushLogBacklog();
+  }
+}
+
+void resetEnergyReport() {
+  reportStart = millis();
+  dozeMs = 0;
+  wakeCount = 0;
+  maxReactionMs = 0;
+  reactionCount = 0;
+}
+
+void reportEnergy() {
+  if(!AppConfig.PowerSave) {
+    resetEnergyReport();
+    return;
+  }
+
+  unsigned long period = millis() - reportStart;
+  if(period < ENERGY_REPORT_MS) {
+    return;
+  }
+
+  double hours = period / 3600000.0;
+  double awakeMAh = (period - dozeMs) * CURRENT_AWAKE_MA / 3600000.0;
+  double lowMAh = (awakeMAh + dozeMs * CURRENT_LIGHT_SLEEP_MA / 3600000.0) / hours;
+  double highMAh = (awakeMAh + dozeMs * CURRENT_MODEM_SLEEP_MA / 3600000.0) / hours;
+  log("Power: dozed %lu%% of %lu min, est. %.1f-%.1f mAh/h (%.1f-%.1f mWh/h at %.1fV). "
+    "Wakes: %u, float changes after a wake: %u, max reaction %lu ms.",
+    dozeMs / (period / 100), period / 60000, lowMAh, highMAh,
+    SUPPLY_VOLTAGE * lowMAh, SUPPLY_VOLTAGE * highMAh, SUPPLY_VOLTAGE,
+    wakeCount, reactionCount, maxReactionMs);
+
+  resetEnergyReport();
+}
+
+void floatChangeRegistered() {
+  if(!wakePending) {
+    return;
+  }
+  wakePending = false;
+  unsigned long reaction = millis() - pendingWakeSince;
+  if(reaction > maxReactionMs) {
+    maxReactionMs = reaction;
+  }
+  reactionCount++;
+}
+
+void updatePowerMode(bool canDoze) {
+  canDoze = canDoze && AppConfig.PowerSave;
+  if(canDoze && !dozing) {
+    enterDoze();
+  }
+  else if(!canDoze && dozing) {
+    leaveDoze();
+  }
+
+  if(wakePending && (millis() - pendingWakeSince > AppConfig.ActiveHoldMs)) {
+    // Woken by the button, or a float that bounced without changing state.
+    wakePending = false;
+  }
+
+  if(dozing) {
+    updateRadioWindow();
+  }
+
+  reportEnergy();
+}
+
+bool doze(unsigned long ms) {
+  if(!dozing || ms == 0) {
+    yield();
+    return false;
+  }
+
+  unsigned long start = millis();
+  lastWakeCheck = start;
+  bool woken = false;
+  armWakePins();
+  // Sleeps until a wake pin interrupt, or the end of the sampling period. Checking the pins
+  // every DozeWakeCheckMs is only a fallback, in case an interrupt was missed.
+  esp_delay(ms, [&woken]() {
+    if(wakeEdge || wakePinLow()) {
+      woken = true;
+      return false;
+    }
+    lastWakeCheck = millis();
+    return true;
+  }, AppConfig.DozeWakeCheckMs);
+  disarmWakePins();
+
+  if(woken) {
+    wakeCount++;
+    if(!wakePending) {
+      wakePending = true;
+      pendingWakeSince = wakeEdge ? wakeEdgeTime : lastWakeCheck;
+    }
+  }
+  dozeMs += millis() - start;
+
+  return woken;
+}
@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include <Ticker.h>
+#include <main.h>
+
+// Software watchdog for loop(). Keeps track of which stage of loop() is running and for how
+// long. A stalled stage, or a crash, leaves a post-mortem in RTC memory, which survives the
+// reset and gets attached to the RESET notification.
+
+#define WATCHDOG_TICK_MS      1000
+#define WIFI_STALL_LIMIT_MS   (90 * 1000) // setupWiFi() waits up to a minute by design.
+#define LOOP_HISTORY_LEN      8
+#define POST_MORTEM_MAGIC     0x53504d31 // "SPM1"
+#define POST_MORTEM_RTC_OFFSET  32 // In 4 byte blocks. The first 128 bytes belong to OTA (eboot).
+#define POST_MORTEM_TXT_LEN   320
+
+const char* stageNames[] = {
+  "idle", "setup", "reset notify", "config", "button", "floats", "alarm", "mqtt", "ota", "power", "doze", "wifi",
+};
+#define STAGE_NAME_COUNT  (sizeof(stageNames) / sizeof(stageNames[0]))
+
+struct PostMortem {
+  uint32_t Magic;
+  uint32_t Stage;
+  uint32_t StageMs;
+  uint32_t Stalled; // Otherwise a crash.
+  uint32_t LoopMs[LOOP_HISTORY_LEN]; // Oldest first.
+};
+
+Ticker watchdogTicker;
+
+volatile byte currentStage = LOOP_STAGE_IDLE;
+volatile unsigned long stageStart = 0;
+bool stallRecorded = false;
+
+unsigned long loopStart = 0;
+unsigned long loopMs[LOOP_HISTORY_LEN];
+byte loopMsNext = 0;
+
+char postMortemText[POST_MORTEM_TXT_LEN] = "";
+
+const char* stageName(uint32_t stage) {
+  return stage < STAGE_NAME_COUNT ? stageNames[stage] : "unknown";
+}
+
+void savePostMortem(bool stalled) {
+  PostMortem pm;
+  pm.Magic = POST_MORTEM_MAGIC;
+  pm.Stage = currentStage;
+  pm.StageMs = millis() - stageStart;
+  pm.Stalled = stalled;
+  for(int n = 0; n < LOOP_HISTORY_LEN; n++) {
+    pm.LoopMs[n] = loopMs[(loopMsNext + n) % LOOP_HISTORY_LEN];
+  }
+  ESP.rtcUserMemoryWrite(POST_MORTEM_RTC_OFFSET, (uint32_t*)&pm, sizeof(pm));
+}
+
+void clearPostMortem() {
+  uint32_t magic = 0;
+  ESP.rtcUserMemoryWrite(POST_MORTEM_RTC_OFFSET, &magic, sizeof(magic));
+}
+
+// Called by the core on exceptions and software watchdog resets.
+extern "C" void custom_crash_callback(struct rst_info* rst_info, uint32_t stack, uint32_t stack_end) {
+  savePostMortem(false);
+}
+
+// Runs from the system timer, so it gets to run while loop() is blocked in delay() or on the network.
+void checkStall() {
+  if(currentStage == LOOP_STAGE_IDLE || currentStage == LOOP_STAGE_DOZE) {
+    // Dozing blocks for up to a sampling period on purpose.
+    return;
+  }
+  unsigned long limit = (currentStage == LOOP_STAGE_WIFI) ? WIFI_STALL_LIMIT_MS : AppConfig.StallLimitMs;
+  if(millis() - stageStart > limit) {
+    // Keep the duration current, in case the stall ends up in a reset.
+    savePostMortem(true);
+    stallRecorded = true;
+  }
+}
+
+// Returns the stage that was running, so a nested stage can hand back to it.
+byte enterStage(byte stage) {
+  bool stalled = stallRecorded;
+  byte previousStage = currentStage;
+  unsigned long previousMs = millis() - stageStart;
+
+  currentStage = stage;
+  stageStart = millis();
+
+  // Dozing isn't watched, and the ticker would keep waking the cpu out of light sleep.
+  if(stage == LOOP_STAGE_DOZE) {
+    watchdogTicker.detach();
+  }
+  else if(!watchdogTicker.active()) {
+    watchdogTicker.attach_ms(WATCHDOG_TICK_MS, checkStall);
+  }
+
+  if(stalled) {
+    // The stage did finish after all.
+    stallRecorded = false;
+    clearPostMortem();
+    log("Loop stage '%s' stalled for %lu ms.", stageName(previousStage), previousMs);
+  }
+  return previousStage;
+}
+
+void startLoopTiming() {
+  loopStart = millis();
+}
+
+void endLoopTiming() {
+  loopMs[loopMsNext] = millis() - loopStart;
+  loopMsNext = (loopMsNext + 1) % LOOP_HISTORY_LEN;
+}
+
+void loadPostMortem() {
+  size_t txtLen = snprintf(postMortemText, POST_MORTEM_TXT_LEN, "Reset reason: %s. %s\n",
+    ESP.getResetReason().c_str(), ESP.getResetInfo().c_str());
+
+  PostMortem pm;
+  ESP.rtcUserMemoryRead(POST_MORTEM_RTC_OFFSET, (uint32_t*)&pm, sizeof(pm));
+  if(pm.Magic != POST_MORTEM_MAGIC || txtLen >= POST_MORTEM_TXT_LEN) {
+    return;
+  }
+  clearPostMortem();
+
+  txtLen += snprintf(postMortemText + txtLen, POST_MORTEM_TXT_LEN - txtLen, "%s in stage '%s' after %u ms.\nRecent loops (ms):",
+    pm.Stalled ? "Stalled" : "Crashed", stageName(pm.Stage), pm.StageMs);
+  for(int n = 0; n < LOOP_HISTORY_LEN && txtLen < POST_MORTEM_TXT_LEN; n++) {
+    txtLen += snprintf(postMortemText + txtLen, POST_MORTEM_TXT_LEN - txtLen, " %u", pm.LoopMs[n]);
+  }
+}
+
+const char* getPostMortem() {
+  return postMortemText;
+}
+
+void setupWatchdog() {
+  loadPostMortem();
+  enterStage(LOOP_STAGE_SETUP); // Starts the ticker.
+}
@@ -4,6 +4,8 @@
 #include <main.h>
 
 void setupWiFi() {
+  // Runs from any stage, and is slow on purpose. Watched with its own limit.
+  byte callerStage = enterStage(LOOP_STAGE_WIFI);
   logd("Setting up Wifi.");
 
   WiFi.disconnect();
@@ -26,6 +28,7 @@ void setupWiFi() {
 
   IPAddress ip = WiFi.localIP();
   log("WiFi setup done. %d.%d.%d.%d %s", ip[0], ip[1], ip[2], ip[3], WiFi.macAddress().c_str());
+  enterStage(callerStage);
 }
 
 bool wifiConnected() {